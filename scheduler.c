@@ -9,6 +9,7 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <time.h>
  
  #define MAX_DOCKS 30
  #define MAX_CARGO_COUNT 200
@@ -19,6 +20,13 @@
  #define MAX_CATEGORY 25
  #define MAX_SHIPS 2000
  #define MAX_STRING_CHARS 6
+ #define MAX_CARGO_WEIGHT_RANGE 1024
+ #define MAX_OUTBOX_MSGS 1024
+ #define OUTBOX_RETRY_USEC 200
+ #define DOCK_LOOKAHEAD 3
+ #define MAX_EMERGENCY_INCOMING 100
+ #define MAX_REGULAR_INCOMING 1000
+ #define MAX_OUTGOING 500
  
  #define MSG_TYPE_NEW_REQUEST 1
  #define MSG_TYPE_DOCK 2
@@ -50,6 +58,9 @@
      int dockedAt;
      int cargoMovedTill;
      int numCargodoc;
+     int reservedShipId;
+     int reservedShipDirection;
+     int reservedUntil;  // reservation is live while currentTimestep <= reservedUntil
  } Dock;
  
  typedef struct {
@@ -73,6 +84,8 @@
      bool isDocked;
      int assignedDockId;
      int dockedAt;
+     bool wasHeld;
+     unsigned int eligibleDocks;  // bit j set when docks[j] can finish this ship
  } Ship;
  
  typedef struct {
@@ -203,9 +216,9 @@ const char *prefixSets[7][MAX_SOLVERS][MAX_PREFIXES_PER_THREAD] = {
 
  volatile bool authStringFound[MAX_DOCKS] = { false };
 
- Ship emergencyIncoming[100];    
- Ship regularIncoming[1000];    
- Ship outgoingShips[500];   
+ Ship emergencyIncoming[MAX_EMERGENCY_INCOMING];    
+ Ship regularIncoming[MAX_REGULAR_INCOMING];    
+ Ship outgoingShips[MAX_OUTGOING];   
 
  int emergencyIncomingCount = 0;
  int regularIncomingCount = 0;
@@ -215,6 +228,27 @@ const char *prefixSets[7][MAX_SOLVERS][MAX_PREFIXES_PER_THREAD] = {
  int numShips;
  int currentTimestep = 1;
 
+ #define MAIN_MSG_SIZE (sizeof(MessageStruct) - sizeof(long))
+
+ // Outbound staging for mainMsgId. Shared with the guess threads, so every
+ // access goes through outboxLock.
+ MessageStruct outbox[MAX_OUTBOX_MSGS];
+ int outboxHead = 0;
+ int outboxCount = 0;
+ int mainQueueRoom = 0;
+ pthread_mutex_t outboxLock = PTHREAD_MUTEX_INITIALIZER;
+
+ // Blocked time while the outbox was full. The drain that overlaps the
+ // undock search and the expected wait before END_TIMESTEP are kept apart.
+ // Release timestep per docks[] slot, filled at the start of each planning
+ // pass; -1 when not known within DOCK_LOOKAHEAD.
+ int dockReleaseAt[MAX_DOCKS];
+
+ long long mainQueueStallNs = 0;
+ long long mainQueueUndockDrainNs = 0;
+ long long mainQueueEndDrainNs = 0;
+ int mainQueueStagedMsgs = 0;
+
  int compareDocksByCategory(const void *a, const void *b) {
   Dock *d1 = (Dock *)a;
   Dock *d2 = (Dock *)b;
@@ -290,39 +324,301 @@ const char *prefixSets[7][MAX_SOLVERS][MAX_PREFIXES_PER_THREAD] = {
      }
  }
  
+ void refreshMainQueueRoom() {
+     struct msqid_ds stat;
+     if (msgctl(mainMsgId, IPC_STAT, &stat) == -1) {
+         mainQueueRoom = 1;  // unknown, let msgsnd decide
+         return;
+     }
+     long room = ((long)stat.msg_qbytes - (long)stat.msg_cbytes) / (long)MAIN_MSG_SIZE;
+     mainQueueRoom = room > 0 ? (int)room : 0;
+ }
+
+ // Caller holds outboxLock.
+ bool trySendMainMsg(MessageStruct *msg) {
+     if (mainQueueRoom <= 0) refreshMainQueueRoom();
+     if (mainQueueRoom <= 0) return false;
+
+     if (msgsnd(mainMsgId, msg, MAIN_MSG_SIZE, IPC_NOWAIT) == -1) {
+         if (errno == EAGAIN || errno == EINTR) {
+             mainQueueRoom = 0;
+             return false;
+         }
+         perror("msgsnd main");
+         return true;
+     }
+     mainQueueRoom--;
+     return true;
+ }
+
+ // Caller holds outboxLock.
+ void flushOutboxLocked() {
+     while (outboxCount > 0 && trySendMainMsg(&outbox[outboxHead])) {
+         outboxHead = (outboxHead + 1) % MAX_OUTBOX_MSGS;
+         outboxCount--;
+     }
+ }
+
+ // Caller holds outboxLock. Returns once everything staged is in the queue.
+ // The lock is dropped while waiting for room so guess threads can still
+ // stage their UNDOCK messages; sends always go out from the head, so
+ // ordering is kept.
+ void drainOutboxLocked(long long *stallNs) {
+     flushOutboxLocked();
+     if (outboxCount == 0) return;
+
+     struct timespec start, end;
+     clock_gettime(CLOCK_MONOTONIC, &start);
+     while (outboxCount > 0) {
+         pthread_mutex_unlock(&outboxLock);
+         usleep(OUTBOX_RETRY_USEC);
+         pthread_mutex_lock(&outboxLock);
+         flushOutboxLocked();
+     }
+     clock_gettime(CLOCK_MONOTONIC, &end);
+     *stallNs += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+ }
+
+ // Non-blocking send to the main queue; overflow is staged in order.
+ void sendMainMsg(MessageStruct *msg) {
+     pthread_mutex_lock(&outboxLock);
+     flushOutboxLocked();
+     if (outboxCount > 0 || !trySendMainMsg(msg)) {
+         if (outboxCount == MAX_OUTBOX_MSGS) drainOutboxLocked(&mainQueueStallNs);
+         outbox[(outboxHead + outboxCount) % MAX_OUTBOX_MSGS] = *msg;
+         outboxCount++;
+         mainQueueStagedMsgs++;
+     }
+     pthread_mutex_unlock(&outboxLock);
+ }
+
+ void flushMainOutbox() {
+     pthread_mutex_lock(&outboxLock);
+     flushOutboxLocked();
+     pthread_mutex_unlock(&outboxLock);
+ }
+
+ void drainMainOutbox(long long *stallNs) {
+     pthread_mutex_lock(&outboxLock);
+     drainOutboxLocked(stallNs);
+     pthread_mutex_unlock(&outboxLock);
+ }
+
+ bool isReservedFor(Dock *dock, Ship *ship) {
+  return dock->reservedUntil >= currentTimestep &&
+         dock->reservedShipId == ship->shipId &&
+         dock->reservedShipDirection == ship->direction;
+ }
+
+ void reserveDock(Dock *dock, Ship *ship, int until) {
+  dock->reservedShipId = ship->shipId;
+  dock->reservedShipDirection = ship->direction;
+  dock->reservedUntil = until;
+ }
+
+ void dockShip(Ship *ship, Dock *dock) {
+      ship->isDocked = true;
+      ship->dockedAt = currentTimestep;
+      
+      ship->assignedDockId = dock->originalDockId;
+      dock->isOccupied = true;
+      dock->dockedAt = currentTimestep;
+      dock->occupyingShipId = ship->shipId;
+      dock->occupyingShipDirection = ship->direction;
+      dock->numCargodoc = ship->numCargo;
+
+      for (int j = 0; j < numDocks; ++j)
+          if (isReservedFor(&docks[j], ship)) docks[j].reservedUntil = 0;
+
+      MessageStruct msg;
+      msg.mtype = MSG_TYPE_DOCK;
+      msg.shipId = ship->shipId;
+      msg.direction = ship->direction;
+      msg.dockId = dock->originalDockId;
+      sendMainMsg(&msg);
+ }
+
+ bool isWaitingForDock(Ship *ship) {
+  if (ship->isDocked || ship->direction == 0) return false;
+  if ((ship->direction==1) && (ship->emergency==0) && (currentTimestep>ship->cutoffTime)) return false;
+  return true;
+ }
+
+ bool hasReservedDock(Ship *ship) {
+  for (int j = 0; j < numDocks; ++j)
+      if (isReservedFor(&docks[j], ship)) return true;
+  return false;
+ }
+
+ // docks[] is sorted by category, so the first fit is the tightest one.
+ // Emergency ships ignore reservations.
+ int findFreeDock(Ship *ship, int skipDock) {
+  for (int j = 0; j < numDocks; ++j) {
+      if (j == skipDock) continue;
+      if (docks[j].isOccupied || !(ship->eligibleDocks & (1u << j))) continue;
+      if (!ship->emergency && docks[j].reservedUntil >= currentTimestep && !isReservedFor(&docks[j], ship))
+          continue;
+      return j;
+  }
+  return -1;
+ }
+
  void assignShipsToDocks(Ship *shipArray, int shipCount) {
   for (int i = 0; i < shipCount; ++i) {
       Ship *ship = &shipArray[i];
-      if (ship->isDocked || ship->direction == 0) continue;
-      if ((ship->direction==1) && (ship->emergency==0) && (currentTimestep>ship->cutoffTime)) continue;
-
-      for (int j = 0; j < numDocks; ++j) {
-          Dock *dock = &docks[j];
-          if (!dock->isOccupied && dock->category >= ship->category) {
-              ship->isDocked = true;
-              ship->dockedAt = currentTimestep;
-              
-              ship->assignedDockId = dock->originalDockId;
-              dock->isOccupied = true;
-              dock->dockedAt = currentTimestep;
-              dock->occupyingShipId = ship->shipId;
-              dock->occupyingShipDirection = ship->direction;
-              dock->numCargodoc = ship->numCargo;
-
-              MessageStruct msg;
-              msg.mtype = MSG_TYPE_DOCK;
-              msg.shipId = ship->shipId;
-              msg.direction = ship->direction;
-              msg.dockId = dock->originalDockId;
-              msgsnd(mainMsgId, &msg, sizeof(MessageStruct) - sizeof(long), 0);
-              break;
+      if (!isWaitingForDock(ship)) continue;
+
+      int j = findFreeDock(ship, -1);
+      if (j != -1)
+          dockShip(ship, &docks[j]);
+  }
+}
+
+ Ship *findOccupyingShip(Dock *dock) {
+  Ship *arrays[3] = { emergencyIncoming, regularIncoming, outgoingShips };
+  int counts[3] = { emergencyIncomingCount, regularIncomingCount, outgoingCount };
+  for (int a = 0; a < 3; ++a) {
+      for (int i = 0; i < counts[a]; ++i) {
+          Ship *ship = &arrays[a][i];
+          if (ship->isDocked && ship->shipId == dock->occupyingShipId &&
+              ship->direction == dock->occupyingShipDirection &&
+              ship->assignedDockId == dock->originalDockId)
+              return ship;
+      }
+  }
+  return NULL;
+ }
+
+ // Timestep at which an occupied dock becomes free (undock at
+ // cargoDoneAt + 1, freed at + 2). While the ship is still loading, the
+ // crane/cargo greedy of performCargoAssignment is replayed on a copy of
+ // the used flags, so the result is exact. -1 when the dock does not free
+ // up within DOCK_LOOKAHEAD timesteps or never finishes.
+ int simulateDockRelease(Dock *dock) {
+  if (!dock->isOccupied) return -1;
+  if (dock->cargoDoneAt != 0) return dock->cargoDoneAt + 2;
+
+  Ship *ship = findOccupyingShip(dock);
+  if (ship == NULL || ship->numCargo == 0) return -1;
+
+  bool used[MAX_CARGO_COUNT];
+  for (int j = 0; j < ship->numCargo; ++j) used[j] = ship->cargo[j].used;
+  int moved = ship->cargoMovedTill;
+
+  int firstMove = ship->dockedAt + 1 > currentTimestep ? ship->dockedAt + 1 : currentTimestep;
+  for (int t = firstMove; t + 2 - currentTimestep <= DOCK_LOOKAHEAD; ++t) {
+      int movedBefore = moved;
+      for (int i = 0; i < dock->numCranes; ++i) {
+          bool assigned = false;
+          for (int j = 0; j < ship->numCargo; ++j) {
+              if (!used[j] && dock->cranes[i].capacity >= ship->cargo[j].weight) {
+                  used[j] = true;
+                  moved++;
+                  assigned = true;
+                  break;
+              }
           }
+          if (moved == ship->numCargo) return t + 2;
+          if (!assigned) break;
       }
+      if (moved == movedBefore) return -1;
   }
-}
+  return -1;
+ }
 
- 
-void performCargoAssignment(Ship *shipArray, int count)
+ // Unreserved occupied dock the ship can use that frees up earliest, within
+ // DOCK_LOOKAHEAD timesteps and before the ship's cutoff, or -1.
+ int findUpcomingRelease(Ship *ship, int *releaseAt) {
+  int best = -1;
+  for (int j = 0; j < numDocks; ++j) {
+      Dock *dock = &docks[j];
+      if (!dock->isOccupied || dock->reservedUntil >= currentTimestep) continue;
+      if (!(ship->eligibleDocks & (1u << j))) continue;
+
+      int release = dockReleaseAt[j];
+      if (release == -1) continue;
+      if (ship->direction == 1 && release > ship->cutoffTime) continue;
+      if (best == -1 || release < *releaseAt) {
+          best = j;
+          *releaseAt = release;
+      }
+  }
+  return best;
+ }
+
+ // Timesteps until a dock the ship could take frees up, ignoring skipDock
+ // and docks reserved for other ships; -1 if none does within the horizon.
+ int estimateWaitForDock(Ship *ship, int skipDock) {
+  int wait = -1;
+  for (int j = 0; j < numDocks; ++j) {
+      if (j == skipDock || !docks[j].isOccupied || !(ship->eligibleDocks & (1u << j))) continue;
+      if (docks[j].reservedUntil >= currentTimestep && !isReservedFor(&docks[j], ship)) continue;
+      int release = dockReleaseAt[j];
+      if (release == -1) continue;
+      if (wait == -1 || release - currentTimestep < wait) wait = release - currentTimestep;
+  }
+  return wait;
+ }
+
+ // Non-emergency docking with a short rolling horizon. A ship whose tightest
+ // free dock is oversized gives that dock to a lower-priority waiting ship
+ // with nowhere else to go when:
+ //  - a dock the held ship can use frees up within DOCK_LOOKAHEAD
+ //    timesteps and before its cutoff, and
+ //  - the other ship would otherwise miss its cutoff or wait longer than
+ //    the held ship's delay.
+ // A ship is held at most once.
+ // The free dock is reserved for the other ship this timestep and the
+ // releasing dock for the held ship until its expected release. Emergency
+ // ships are docked beforehand and ignore reservations.
+ void planDockAssignments() {
+  Ship *queue[MAX_REGULAR_INCOMING + MAX_OUTGOING];
+  int queueCount = 0;
+
+  for (int j = 0; j < numDocks; ++j)
+      dockReleaseAt[j] = simulateDockRelease(&docks[j]);
+
+  for (int i = 0; i < regularIncomingCount; ++i)
+      if (isWaitingForDock(&regularIncoming[i])) queue[queueCount++] = &regularIncoming[i];
+  for (int i = 0; i < outgoingCount; ++i)
+      if (isWaitingForDock(&outgoingShips[i])) queue[queueCount++] = &outgoingShips[i];
+
+  for (int i = 0; i < queueCount; ++i) {
+      Ship *ship = queue[i];
+      int j = findFreeDock(ship, -1);
+      if (j == -1) continue;
+
+      bool hold = false;
+      if (docks[j].category > ship->category && !ship->wasHeld && !hasReservedDock(ship)) {
+          int releaseAt;
+          int r = findUpcomingRelease(ship, &releaseAt);
+
+          for (int k = i + 1; k < queueCount && r != -1 && !hold; ++k) {
+              Ship *other = queue[k];
+              if (other->isDocked || other->category <= ship->category) continue;
+              if (!(other->eligibleDocks & (1u << j))) continue;
+              if (hasReservedDock(other)) continue;
+              if (findFreeDock(other, j) != -1) continue;
+
+              int heldDelay = releaseAt - currentTimestep;
+              int otherWait = estimateWaitForDock(other, r);
+              bool otherMissesCutoff = other->direction == 1 &&
+                  (otherWait == -1 || currentTimestep + otherWait > other->cutoffTime);
+              if (!otherMissesCutoff && otherWait != -1 && otherWait <= heldDelay) continue;
+
+              reserveDock(&docks[j], other, currentTimestep);
+              reserveDock(&docks[r], ship, releaseAt);
+              ship->wasHeld = true;
+              hold = true;
+          }
+      }
+
+      if (!hold)
+          dockShip(ship, &docks[j]);
+  }
+ }
+
+ void performCargoAssignment(Ship *shipArray, int count)
 {
     for (int d = 0; d < numDocks; ++d) {
       Dock *dock = &docks[d];
@@ -364,7 +660,7 @@ void performCargoAssignment(Ship *shipArray, int count)
                   msg.cargoId = ship->cargo[j].originalIndex;
                   msg.data.craneId = crane->originalCraneId;
 
-                  msgsnd(mainMsgId, &msg, sizeof(MessageStruct) - sizeof(long), 0);
+                  sendMainMsg(&msg);
 
                   ship->cargo[j].used = true;
                   ship->cargoMovedTill++;
@@ -447,7 +743,7 @@ void* guessAuthStringThread(void *arg) {
                 msg.shipId = args->shipId;
                 msg.direction = args->direction;
                 msg.dockId = dockId;
-                msgsnd(mainMsgId, &msg, sizeof(MessageStruct) - sizeof(long), 0);
+                sendMainMsg(&msg);
 
                 pthread_exit(NULL);
             }
@@ -515,7 +811,7 @@ void* fastGuessLen1Thread(void *arg) {
             msg.direction = args->direction;
             msg.dockId = dockId;
 
-            msgsnd(mainMsgId, &msg, sizeof(MessageStruct) - sizeof(long), 0);
+            sendMainMsg(&msg);
             pthread_exit(NULL);
         }
     }
@@ -589,6 +885,9 @@ void performUndocking()
 
           dock->undockingDone = true;
 
+          // let staged cargo moves drain while the solvers search
+          drainMainOutbox(&mainQueueUndockDrainNs);
+
           for (int i = 0; i < numSolvers; ++i)
               pthread_join(threads[i], NULL);
       }
@@ -622,6 +921,76 @@ void performUndocking()
     return -1;
     }
 
+    // cargo is sorted heaviest first and so are each dock's cranes, so a
+    // dock can finish the ship iff its best crane lifts cargo[0].
+    void computeDockEligibility(Ship *ship) {
+    int maxWeight = ship->numCargo > 0 ? ship->cargo[0].weight : 0;
+    ship->eligibleDocks = 0;
+    for (int j = 0; j < numDocks; ++j) {
+        if (docks[j].category < ship->category) continue;
+        if (docks[j].numCranes == 0 || docks[j].cranes[0].capacity < maxWeight) continue;
+        ship->eligibleDocks |= 1u << j;
+    }
+    }
+
+    // A resend is unchanged when everything but the timing fields matches
+    // what we already hold. Cargo is compared through originalIndex so the
+    // sorted copy never has to be rebuilt.
+    bool isUnchangedResend(const Ship *ship, const ShipRequest *req) {
+    if (ship->isDocked) return false;
+    if (ship->category != req->category || ship->emergency != req->emergency)
+        return false;
+    if (ship->numCargo != req->numCargo) return false;
+
+    for (int k = 0; k < ship->numCargo; ++k) {
+        if (req->cargo[ship->cargo[k].originalIndex] != ship->cargo[k].weight)
+            return false;
+    }
+    return true;
+    }
+
+    // Sorts cargo by descending weight straight from the shm request into
+    // the ship's storage. Counting sort when the weight range is small,
+    // otherwise fall back to copy + qsort.
+    void loadSortedCargo(Ship *ship, const ShipRequest *req) {
+    int n = req->numCargo;
+    if (n <= 0) return;
+
+    int minW = req->cargo[0], maxW = req->cargo[0];
+    for (int j = 1; j < n; ++j) {
+        if (req->cargo[j] < minW) minW = req->cargo[j];
+        if (req->cargo[j] > maxW) maxW = req->cargo[j];
+    }
+
+    if (maxW - minW >= MAX_CARGO_WEIGHT_RANGE) {
+        for (int j = 0; j < n; ++j) {
+            ship->cargo[j].weight = req->cargo[j];
+            ship->cargo[j].originalIndex = j;
+            ship->cargo[j].used = false;
+        }
+        qsort(ship->cargo, n, sizeof(CargoItem), compareCargoByWeight);
+        return;
+    }
+
+    int range = maxW - minW + 1;
+    int count[MAX_CARGO_WEIGHT_RANGE + 1];
+    memset(count, 0, sizeof(int) * (range + 1));
+
+    // bucket 0 holds the heaviest weight
+    for (int j = 0; j < n; ++j)
+        count[maxW - req->cargo[j] + 1]++;
+    for (int b = 1; b <= range; ++b)
+        count[b] += count[b - 1];
+
+    for (int j = 0; j < n; ++j) {
+        int w = req->cargo[j];
+        CargoItem *item = &ship->cargo[count[maxW - w]++];
+        item->weight = w;
+        item->originalIndex = j;
+        item->used = false;
+    }
+    }
+
 
  
 void handleTimestep(MessageStruct msg)
@@ -652,46 +1021,51 @@ void handleTimestep(MessageStruct msg)
       {
           ShipRequest *req = &sharedMemory->newShipRequests[i];
           Ship *ship;
+          int idx;
+          bool isResend = false;
           
           if (req->direction == 1 && req->emergency == 1) {
-            int idx = findShipIndex(emergencyIncoming, emergencyIncomingCount, req->shipId, req->direction);
+            idx = findShipIndex(emergencyIncoming, emergencyIncomingCount, req->shipId, req->direction);
+            isResend = (idx != -1);
             if (idx == -1)
                 idx = emergencyIncomingCount++;
             ship = &emergencyIncoming[idx];
           }
           else if (req->direction == 1 && req->emergency == 0) {
-              int idx = findShipIndex(regularIncoming, regularIncomingCount, req->shipId, req->direction);
+              idx = findShipIndex(regularIncoming, regularIncomingCount, req->shipId, req->direction);
+              isResend = (idx != -1);
               if (idx == -1)
                   idx = regularIncomingCount++;
               ship = &regularIncoming[idx];
           }
           else if (req->direction == -1) {
-              int idx = findShipIndex(outgoingShips, outgoingCount, req->shipId, req->direction);
+              idx = findShipIndex(outgoingShips, outgoingCount, req->shipId, req->direction);
+              isResend = (idx != -1);
               if (idx == -1)
                   idx = outgoingCount++;
               ship = &outgoingShips[idx];
           }
+
+          ship->arrivalTime = req->timestep;
+          ship->waitingTime = req->waitingTime;
+          ship->cutoffTime = req->timestep + req->waitingTime;
+
+          if (isResend && isUnchangedResend(ship, req))
+              continue;
         
           
           ship->shipId = req->shipId;
-          ship->arrivalTime = req->timestep;
           ship->category = req->category;
           ship->direction = req->direction;
           ship->emergency = req->emergency;
-          ship->waitingTime = req->waitingTime;
-          ship->cutoffTime = req->timestep + req->waitingTime;
           ship->numCargo = req->numCargo;
           ship->isDocked = false;
           ship->assignedDockId = -1;
+          ship->wasHeld = false;
           ship->cargoMovedTill=0;
 
-  
-          for (int j = 0; j < ship->numCargo; ++j) {
-              ship->cargo[j].weight = req->cargo[j];
-              ship->cargo[j].originalIndex = j;
-          }
-
-          qsort(ship->cargo, ship->numCargo, sizeof(CargoItem), compareCargoByWeight);
+          loadSortedCargo(ship, req);
+          computeDockEligibility(ship);
       }
 
       qsort(emergencyIncoming, emergencyIncomingCount, sizeof(Ship), compareShipsByCutoffTime);
@@ -699,18 +1073,20 @@ void handleTimestep(MessageStruct msg)
       qsort(outgoingShips, outgoingCount, sizeof(Ship), compareShipsByArrivalTime); // new comparator
    
      assignShipsToDocks(emergencyIncoming, emergencyIncomingCount);
-     assignShipsToDocks(regularIncoming, regularIncomingCount);
-     assignShipsToDocks(outgoingShips,outgoingCount);
+     planDockAssignments();
+     flushMainOutbox();
      
     performCargoAssignment(emergencyIncoming, emergencyIncomingCount);
     performCargoAssignment(regularIncoming, regularIncomingCount);
     performCargoAssignment(outgoingShips, outgoingCount);
+    flushMainOutbox();
 
 
      performUndocking();
  
      MessageStruct endMsg = {.mtype = MSG_TYPE_END_TIMESTEP};
-     msgsnd(mainMsgId, &endMsg, sizeof(MessageStruct) - sizeof(long), 0);
+     sendMainMsg(&endMsg);
+     drainMainOutbox(&mainQueueEndDrainNs);
  }
  
  int main(int argc, char *argv[]) {
@@ -742,6 +1118,9 @@ void handleTimestep(MessageStruct msg)
         
          handleTimestep(msg);
      }
+
+     fprintf(stderr, "main queue: %d msgs staged, %.3f ms stalled, %.3f ms undock-phase drain, %.3f ms end-of-timestep drain\n",
+             mainQueueStagedMsgs, mainQueueStallNs / 1e6, mainQueueUndockDrainNs / 1e6, mainQueueEndDrainNs / 1e6);
  
      return 0;
  }